@@ -46,6 +46,11 @@ class Graph {
     }
   }
 
+  [[nodiscard]]
+  bool hasVertex(vertex_index_t v) const {
+    return m_data_.count(v) != 0;
+  }
+
   [[nodiscard]]
   bool hasEdge(vertex_index_t u, vertex_index_t v) const {
     if (m_data_.count(v) == 0 || m_data_.count(u) == 0) return false;
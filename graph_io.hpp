@@ -24,27 +24,23 @@ void write_dot(const Graph &g, std::ostream &os) {
 }
 void write_dot(const Tree &t, std::ostream &os) {
   os << "digraph {" << std::endl;
-  std::function<void(vertex_index_t)> rec;
-  rec = [t, &rec, &os](vertex_index_t id) {
-    const auto &node = t.getNode(id);
+  for (tree_index_t id = 0; id < t.order(); id++) {
+    auto bag = t.bag(id);
     os << "\t" << id << " [label = \"{";
-    auto i{0};
-    for(auto v : node._bag) {
-      if(i++ == node._bag.size() - 1) {
-        os << v;
+    for (size_t i = 0; i < bag.size(); i++) {
+      if (i == bag.size() - 1) {
+        os << bag[i];
       } else {
-        os << v << ", ";
+        os << bag[i] << ", ";
       }
     }
     os << "}\"]" << std::endl;
-    for(auto c : node._children) {
-      rec(c);
-    }
-    for(auto c : node._children) {
+  }
+  for (tree_index_t id = 0; id < t.order(); id++) {
+    for (auto c : t.children(id)) {
       os << "\t" << id << " -> " << c << std::endl;
     }
-  };
-  rec(t.getRoot());
+  }
   os << "}" << std::endl;
 }
 void write_json(const Graph &g, const std::string &fileName) {
@@ -104,23 +100,21 @@ void write_pace(const Graph &g, const std::string &fileName) {
 
 void write_pace(const Tree &t, size_t tw, size_t order, std::ostream &os) {
   os << "s td" << " " << t.order() << " " << tw << " " << order << std::endl;
-  for(const auto& n : t) {
-    os << n.first << " ";
-    size_t i{0};
-    for(const auto &v : n.second._bag) {
-      if(i == n.second._bag.size() - 1) {
-        os << v;
+  for (tree_index_t id = 0; id < t.order(); id++) {
+    auto bag = t.bag(id);
+    os << id + 1 << " ";
+    for (size_t i = 0; i < bag.size(); i++) {
+      if (i == bag.size() - 1) {
+        os << bag[i];
       } else {
-        os << v << " ";
+        os << bag[i] << " ";
       }
     }
     os << std::endl;
   }
-  for(const auto& n : t) {
-    if(!n.second._children.empty()) {
-      for(const auto &v : n.second._children) {
-        os << n.first << " " << v << std::endl;
-      }
+  for (tree_index_t id = 0; id < t.order(); id++) {
+    for (auto c : t.children(id)) {
+      os << id + 1 << " " << c + 1 << std::endl;
     }
   }
 }
@@ -0,0 +1,154 @@
+#ifndef QUICKBB_INCREMENTAL_HPP
+#define QUICKBB_INCREMENTAL_HPP
+
+#include <algorithm>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "graph.hpp"
+#include "local_search.hpp"
+#include "quickbb.hpp"
+#include "tree.hpp"
+#include "_types.hpp"
+
+struct edge_update_t {
+  vertex_index_t u{};
+  vertex_index_t v{};
+  // adds the edge if set, removes it otherwise
+  bool insert{true};
+};
+
+// Keeps a graph together with its best elimination order, so a batch of edge
+// updates only re-eliminates the part of the order it touches.
+class IncrementalDecomposition {
+ private:
+  Graph m_graph_;
+  adj_arr_t m_order_;
+  size_t m_width_;
+  bool m_optimal_;
+ public:
+  IncrementalDecomposition(Graph graph, const adj_arr_t &order, bool optimal = false)
+      : m_graph_(std::move(graph)), m_optimal_(optimal) {
+    std::tie(m_order_, m_width_) = evaluate_order(m_graph_, order);
+  }
+
+  IncrementalDecomposition(Graph graph, const Tree &tree, bool optimal = false)
+      : IncrementalDecomposition(std::move(graph), order_from_td(tree), optimal) {}
+
+  [[nodiscard]]
+  const Graph &graph() const {
+    return m_graph_;
+  }
+
+  [[nodiscard]]
+  const adj_arr_t &order() const {
+    return m_order_;
+  }
+
+  [[nodiscard]]
+  size_t width() const {
+    return m_width_;
+  }
+
+  [[nodiscard]]
+  bool optimal() const {
+    return m_optimal_;
+  }
+
+  [[nodiscard]]
+  Tree tree() const {
+    return td_from_order(m_graph_, m_order_);
+  }
+
+  // Applies updates and repairs the order. Only the bags of touched vertices
+  // and their ancestors in the elimination tree change, the other vertices
+  // keep their previous relative order and are eliminated first. The affected
+  // vertices are then ordered by the min fill heuristic. The search only runs,
+  // seeded with the repaired order, if the repair is wider than before.
+  solve_result_t update(const std::vector<edge_update_t> &updates, const solve_options_t &options) {
+    const auto compact = make_compact(m_graph_);
+    const auto full = complete_order(compact, m_order_);
+    OrderEvaluator evaluator(compact);
+    evaluator.evaluate(full, full.size());
+    std::unordered_map<vertex_index_t, size_t> position;
+    for (size_t i = 0; i < full.size(); i++) {
+      position[compact.labels[full[i]]] = i;
+    }
+
+    std::unordered_set<vertex_index_t> affected;
+    auto only_insertions = true;
+    for (const auto &e : updates) {
+      if (e.u == e.v) continue;
+      auto changed = e.insert ? m_graph_.addEdge(e.u, e.v) : m_graph_.removeEdge(e.u, e.v);
+      if (!changed) continue;
+      only_insertions = only_insertions && e.insert;
+      for (auto w : {e.u, e.v}) {
+        auto found = position.find(w);
+        if (found == position.end()) {
+          affected.insert(w);
+          continue;
+        }
+        for (auto i = found->second; i < full.size(); i = evaluator.parent(i)) {
+          if (!affected.insert(compact.labels[full[i]]).second) break;
+        }
+      }
+    }
+    if (affected.empty()) {
+      return {m_width_, m_order_, m_optimal_};
+    }
+
+    // unaffected vertices form subtrees, whose roots leave their bag as a clique
+    adj_arr_t repaired_order;
+    Graph rest;
+    for (size_t i = 0; i < full.size(); i++) {
+      auto v = compact.labels[full[i]];
+      if (affected.contains(v)) continue;
+      repaired_order.emplace_back(v);
+      auto parent = evaluator.parent(i);
+      if (parent < full.size() && affected.contains(compact.labels[full[parent]])) {
+        adj_arr_t bag;
+        for (auto u : evaluator.higher(full[i])) {
+          bag.emplace_back(compact.labels[u]);
+        }
+        make_clique(rest, bag);
+      }
+    }
+    for (auto v : affected) {
+      if (!m_graph_.hasVertex(v)) continue;
+      for (auto u : m_graph_.getNeighborhood(v)) {
+        if (affected.contains(u)) rest.addEdge(v, u);
+      }
+    }
+    auto affected_order = upper_bound(rest).first;
+    repaired_order.insert(repaired_order.end(), affected_order.begin(), affected_order.end());
+
+    const auto previous_width = m_width_;
+    const auto was_optimal = m_optimal_;
+    auto repaired = evaluate_order(m_graph_, repaired_order);
+    auto kept = evaluate_order(m_graph_, m_order_);
+    if (kept.second < repaired.second) {
+      repaired = kept;
+    }
+
+    std::tie(m_order_, m_width_) = repaired;
+    // inserting edges never lowers the treewidth, so the previous proof still holds
+    m_optimal_ = was_optimal && only_insertions && m_width_ <= previous_width;
+    if (m_width_ <= previous_width) {
+      return {m_width_, m_order_, m_optimal_};
+    }
+
+    auto seeded = options;
+    seeded.initial_order = m_order_;
+    if (was_optimal && only_insertions) {
+      seeded.known_lower_bound = std::max(seeded.known_lower_bound, previous_width);
+    }
+    auto result = solve(m_graph_, seeded);
+    m_order_ = result.order;
+    m_width_ = result.width;
+    m_optimal_ = result.optimal;
+    return result;
+  }
+};
+
+#endif //QUICKBB_INCREMENTAL_HPP
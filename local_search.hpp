@@ -0,0 +1,290 @@
+#ifndef QUICKBB_LOCAL_SEARCH_HPP
+#define QUICKBB_LOCAL_SEARCH_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <unordered_map>
+#include "graph.hpp"
+#include "shared_bound.hpp"
+#include "_types.hpp"
+
+// Graph relabeled to 0..n-1, so orders can be evaluated on flat arrays.
+struct compact_graph_t {
+  adj_arr_t labels{};
+  std::vector<adj_arr_t> adj{};
+};
+
+compact_graph_t make_compact(const Graph &graph) {
+  compact_graph_t compact;
+  std::unordered_map<vertex_index_t, vertex_index_t> index;
+  for (const auto &a : graph) {
+    index[a.first] = compact.labels.size();
+    compact.labels.emplace_back(a.first);
+  }
+  compact.adj.resize(compact.labels.size());
+  for (const auto &a : graph) {
+    auto &nb = compact.adj[index[a.first]];
+    for (auto v : a.second) {
+      nb.emplace_back(index[v]);
+    }
+  }
+  return compact;
+}
+
+struct order_cost_t {
+  size_t width{};
+  // sum of squared bag sizes, used to break ties between orders of equal width
+  size_t fill{};
+};
+
+// Computes the width of an elimination order without building the
+// elimination graph: the higher neighbours of a vertex are handed down to
+// its first eliminated higher neighbour, which is exactly the fill-in.
+//
+// The state of the last evaluated order is kept per position, so an order
+// that only differs from position start on is evaluated from there.
+class OrderEvaluator {
+ private:
+  const compact_graph_t &m_graph_;
+  std::vector<size_t> m_position_;
+  std::vector<adj_arr_t> m_higher_;
+  // position of the vertex each position handed its higher neighbours to
+  std::vector<size_t> m_next_;
+  // cost of the positions before i
+  std::vector<order_cost_t> m_prefix_;
+  // positions before this one are evaluated for the current order
+  size_t m_valid_{0};
+
+  void hand_down(size_t i, vertex_index_t v) {
+    const auto &higher = m_higher_[v];
+    auto next = *std::min_element(higher.begin(), higher.end(), [this](auto a, auto b) {
+      return m_position_[a] < m_position_[b];
+    });
+    m_next_[i] = m_position_[next];
+    for (auto w : higher) {
+      if (w != next) m_higher_[next].emplace_back(w);
+    }
+  }
+
+ public:
+  explicit OrderEvaluator(const compact_graph_t &graph)
+      : m_graph_(graph),
+        m_position_(graph.labels.size()),
+        m_higher_(graph.labels.size()),
+        m_next_(graph.labels.size()),
+        m_prefix_(graph.labels.size() + 1) {}
+
+  // Stops as soon as a bag exceeds cutoff, the returned width is then > cutoff.
+  // If is_last is given, marks vertices without higher neighbours, which
+  // quickbb leaves out of its orders.
+  order_cost_t evaluate(const adj_arr_t &order, size_t cutoff, std::vector<bool> *is_last = nullptr) {
+    m_valid_ = 0;
+    return resume(order, 0, cutoff, is_last);
+  }
+
+  // Like evaluate, for an order equal to the last evaluated one before start.
+  order_cost_t resume(const adj_arr_t &order, size_t start, size_t cutoff, std::vector<bool> *is_last = nullptr) {
+    const auto n = order.size();
+    start = is_last != nullptr ? 0 : std::min(start, m_valid_);
+    for (auto i = start; i < n; i++) {
+      m_position_[order[i]] = i;
+    }
+    for (auto i = start; i < n; i++) {
+      auto v = order[i];
+      m_higher_[v].clear();
+      for (auto u : m_graph_.adj[v]) {
+        if (m_position_[u] > i) m_higher_[v].emplace_back(u);
+      }
+    }
+    // the prefix keeps its bags, only those handed behind start are handed down again
+    for (size_t i = 0; i < start; i++) {
+      if (m_next_[i] >= start && m_next_[i] < n) hand_down(i, order[i]);
+    }
+    if (is_last != nullptr) is_last->assign(n, false);
+
+    auto cost = m_prefix_[start];
+    m_valid_ = start;
+    for (auto i = start; i < n; i++) {
+      m_prefix_[i] = cost;
+      auto v = order[i];
+      auto &higher = m_higher_[v];
+      std::sort(higher.begin(), higher.end());
+      higher.erase(std::unique(higher.begin(), higher.end()), higher.end());
+
+      cost.width = std::max(cost.width, higher.size());
+      cost.fill += (higher.size() + 1) * (higher.size() + 1);
+      if (cost.width > cutoff) return cost;
+      if (higher.empty()) {
+        m_next_[i] = n;
+        if (is_last != nullptr) (*is_last)[v] = true;
+      } else {
+        hand_down(i, v);
+      }
+      m_valid_ = i + 1;
+    }
+    m_prefix_[n] = cost;
+    return cost;
+  }
+
+  // After a complete evaluation: the bag of v without v, sorted.
+  [[nodiscard]]
+  const adj_arr_t &higher(vertex_index_t v) const {
+    return m_higher_[v];
+  }
+
+  // After a complete evaluation: the position of the parent of position i in
+  // the elimination tree, or the order size for a root.
+  [[nodiscard]]
+  size_t parent(size_t i) const {
+    return m_next_[i];
+  }
+
+  // The order changed from position on, without being evaluated.
+  void invalidate(size_t position) {
+    m_valid_ = std::min(m_valid_, position);
+  }
+
+  // Translates a compact order back to graph labels, in the form quickbb uses.
+  adj_arr_t labeled_order(const adj_arr_t &order) {
+    std::vector<bool> is_last;
+    evaluate(order, order.size(), &is_last);
+    adj_arr_t result;
+    for (auto v : order) {
+      if (!is_last[v]) result.emplace_back(m_graph_.labels[v]);
+    }
+    return result;
+  }
+};
+
+// order in compact indices. Vertices of order not in the graph are dropped,
+// vertices of the graph missing in order are appended.
+adj_arr_t complete_order(const compact_graph_t &compact, const adj_arr_t &order) {
+  const auto n = compact.labels.size();
+  std::unordered_map<vertex_index_t, vertex_index_t> index;
+  for (size_t i = 0; i < n; i++) {
+    index[compact.labels[i]] = i;
+  }
+  adj_arr_t full;
+  std::vector<bool> placed(n, false);
+  for (auto v : order) {
+    auto found = index.find(v);
+    if (found == index.end() || placed[found->second]) continue;
+    full.emplace_back(found->second);
+    placed[found->second] = true;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!placed[i]) full.emplace_back(i);
+  }
+  return full;
+}
+
+// Width of order on graph, returned like upper_bound does.
+std::pair<adj_arr_t, size_t> evaluate_order(const Graph &graph, const adj_arr_t &order) {
+  const auto compact = make_compact(graph);
+  const auto full = complete_order(compact, order);
+  OrderEvaluator evaluator(compact);
+  auto width = evaluator.evaluate(full, full.size()).width;
+  return {evaluator.labeled_order(full), width};
+}
+
+// Simulated annealing over elimination orders. A move takes one vertex out of
+// the order and reinserts it elsewhere. Orders better than the shared bound
+// are published, so the branch and bound running next to it prunes harder.
+void local_search(const Graph &graph,
+                  const adj_arr_t &initial_order,
+                  size_t lb,
+                  SharedBound &bound,
+                  const std::atomic<bool> &stop,
+                  std::chrono::steady_clock::time_point deadline) {
+  const auto compact = make_compact(graph);
+  const auto n = compact.labels.size();
+  if (n < 3) return;
+
+  std::unordered_map<vertex_index_t, vertex_index_t> index;
+  for (size_t i = 0; i < n; i++) {
+    index[compact.labels[i]] = i;
+  }
+  adj_arr_t current;
+  std::vector<bool> placed(n, false);
+  for (auto v : initial_order) {
+    auto i = index.at(v);
+    current.emplace_back(i);
+    placed[i] = true;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!placed[i]) current.emplace_back(i);
+  }
+
+  OrderEvaluator evaluator(compact);
+  auto current_cost = evaluator.evaluate(current, n);
+  auto best = current;
+  auto best_cost = current_cost;
+
+  // width dominates, the fill only decides between orders of equal width
+  const double fill_norm = double(n) * double(current_cost.width + 2) * double(current_cost.width + 2);
+  auto energy = [fill_norm](const order_cost_t &c) {
+    return double(c.width) + double(c.fill) / fill_norm;
+  };
+
+  constexpr double initial_temperature = 0.3;
+  constexpr double final_temperature = 0.001;
+  const double cooling = std::pow(final_temperature / initial_temperature, 1.0 / (20.0 * double(n)));
+  auto temperature = initial_temperature;
+
+  std::mt19937_64 rng(n);
+  std::uniform_int_distribution<size_t> position(0, n - 1);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  for (size_t iteration = 0; !stop.load(std::memory_order_relaxed); iteration++) {
+    if (iteration % 64 == 0 &&
+        (std::chrono::steady_clock::now() > deadline || bound.width() <= lb)) {
+      return;
+    }
+    auto from = position(rng);
+    auto to = position(rng);
+    if (from == to) continue;
+
+    auto move = [&current](size_t from, size_t to) {
+      if (from < to) {
+        std::rotate(current.begin() + from, current.begin() + from + 1, current.begin() + to + 1);
+      } else {
+        std::rotate(current.begin() + to, current.begin() + from, current.begin() + from + 1);
+      }
+    };
+    move(from, to);
+
+    // the order before the moved range is untouched
+    auto changed_from = std::min(from, to);
+    auto cost = evaluator.resume(current, changed_from, current_cost.width + 1);
+    auto delta = energy(cost) - energy(current_cost);
+    auto accept = cost.width <= current_cost.width + 1 &&
+        (delta <= 0 || uniform(rng) < std::exp(-delta / temperature));
+    if (accept) {
+      current_cost = cost;
+      if (cost.width < best_cost.width ||
+          (cost.width == best_cost.width && cost.fill < best_cost.fill)) {
+        best = current;
+        best_cost = cost;
+        if (best_cost.width < bound.width()) {
+          bound.offer(best_cost.width, evaluator.labeled_order(best));
+        }
+      }
+    } else {
+      move(to, from);
+      evaluator.invalidate(changed_from);
+    }
+
+    temperature *= cooling;
+    if (temperature < final_temperature) {
+      temperature = initial_temperature;
+      current = best;
+      current_cost = best_cost;
+      evaluator.invalidate(0);
+    }
+  }
+}
+
+#endif //QUICKBB_LOCAL_SEARCH_HPP
@@ -2,6 +2,7 @@
 #include "graph.hpp"
 #include "graph_io.hpp"
 #include "quickbb.hpp"
+#include "result_cache.hpp"
 
 constexpr char PROGRAM_NAME[] = "quickbb";
 
@@ -12,7 +13,8 @@ void print_help() {
             "-h | --help               Print this help" << std::endl <<
             "-t | --time <time>        Sets maximum timeout in seconds. Defaults to 360." << std::endl <<
             "-o | --output <file>      Specifies output file. If none given, outputs to stdout" << std::endl <<
-            "-i | --input <file>       Specifies input file. If none given, reads from stdin" << std::endl;
+            "-i | --input <file>       Specifies input file. If none given, reads from stdin" << std::endl <<
+            "-c | --cache <file>       Reuses and stores results in the given cache file" << std::endl;
 }
 
 int main(int argc, char *argv[]) {
@@ -65,10 +67,35 @@ int main(int argc, char *argv[]) {
     has_input_file = true;
   }
 
+  auto cache_pred = [](const std::string &a) {
+    return a == "-c" || a == "--cache";
+  };
+
+  auto cache_file = std::find_if(args.begin(), args.end(), cache_pred);
+
+  std::optional<ResultCache> cache;
+  if (cache_file != args.end() && ++cache_file != args.end()) {
+    cache.emplace(*cache_file);
+  }
+
   Graph graph;
   graph = read_pace(has_input_file ? input_file_stream : std::cin);
-  auto[tw, elimination_order] = quickbb(graph, alloted_time);
-  auto t = td_from_order(graph, elimination_order);
-  write_pace(t, tw, graph.order(), has_output_file ? output_file_stream : std::cout);
+
+  // canonical labeling is the expensive part of the cache, so it runs once
+  auto form = cache ? canonical_form(graph) : canonical_form_t{};
+  auto cached = cache ? cache->lookup(graph, form) : std::nullopt;
+  solve_result_t result;
+  if (cached && cached->optimal) {
+    std::cout << "found cached elimination order with width " << cached->width << std::endl;
+    result = *cached;
+  } else {
+    // a cached result that is not proven optimal still seeds the search
+    result = quickbb(graph, alloted_time, cached ? cached->order : adj_arr_t{});
+    if (cache && (!cached || result.width < cached->width || result.optimal)) {
+      cache->store(graph, form, result);
+    }
+  }
+  auto t = td_from_order(graph, result.order);
+  write_pace(t, result.width, graph.order(), has_output_file ? output_file_stream : std::cout);
   return 0;
 }
@@ -4,9 +4,17 @@
 #include <set>
 #include <utility>
 #include <chrono>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
 #include "graph.hpp"
 #include "_types.hpp"
 #include "tree.hpp"
+#include "shared_bound.hpp"
+#include "local_search.hpp"
 
 void make_clique(Graph &graph, const adj_arr_t &vertices) {
   for (auto u : vertices) {
@@ -61,32 +69,83 @@ size_t count_fillin(const Graph &graph, adj_arr_t vertices) {
   return count / 2;
 }
 
-std::pair<adj_arr_t, size_t> upper_bound(const Graph &graph) {
+// Connects non adjacent vertices that share at least threshold neighbours,
+// until no such pair is left. Graphs of treewidth below threshold keep their
+// treewidth, so a search for a width below threshold can run on the result.
+bool improve_graph(Graph &graph, size_t threshold) {
+  auto improved = false;
+  std::vector<std::pair<vertex_index_t, vertex_index_t>> new_edges;
+  do {
+    new_edges.clear();
+    for (const auto &a : graph) {
+      std::unordered_map<vertex_index_t, size_t> common;
+      for (auto w : a.second) {
+        for (auto v : graph.getNeighborhood(w)) {
+          if (v > a.first) common[v]++;
+        }
+      }
+      for (const auto &[v, count] : common) {
+        if (count >= threshold && !graph.hasEdge(a.first, v)) {
+          new_edges.emplace_back(a.first, v);
+        }
+      }
+    }
+    for (const auto &[u, v] : new_edges) {
+      improved |= graph.addEdge(u, v);
+    }
+  } while (!new_edges.empty());
+  return improved;
+}
+
+// Vertices by increasing degree, an order that is cheap enough to seed the
+// search before the min fill heuristic has run.
+adj_arr_t degree_order(const Graph &graph) {
+  adj_arr_t vertices;
+  for (const auto &a : graph) {
+    vertices.emplace_back(a.first);
+  }
+  std::stable_sort(vertices.begin(), vertices.end(), [&graph](vertex_index_t u, vertex_index_t v) {
+    return graph.degree(u) < graph.degree(v);
+  });
+  return vertices;
+}
+
+// Min fill heuristic. Polls stop once per eliminated vertex, if it fires the
+// order is incomplete and the width is the maximum size_t.
+std::pair<adj_arr_t, size_t> upper_bound(const Graph &graph, const std::function<bool()> &stop = {}) {
   Graph graph_copy(graph);
   size_t max_degree(0);
   adj_arr_t ordered_vertices;
   using value_t = decltype(graph_copy.begin())::value_type;
 
   while (graph_copy.order() > 0) {
-    auto cmp = [graph_copy](const value_t &u, const value_t &v) {
+    if (stop && stop()) {
+      return {ordered_vertices, std::numeric_limits<size_t>::max()};
+    }
+    auto cmp = [&graph_copy](const value_t &u, const value_t &v) {
       return count_fillin(graph_copy, u.second) < count_fillin(graph_copy, v.second);
     };
 
     auto u = std::min_element(std::begin(graph_copy), std::end(graph_copy), cmp);
     max_degree = std::max(u->second.size(), max_degree);
 
-    eliminate(graph_copy, u->first);
     ordered_vertices.emplace_back(u->first);
+    eliminate(graph_copy, u->first);
   }
   return {ordered_vertices, max_degree};
 }
 
-size_t lower_bound(const Graph &graph) {
+// Minor min width. Polls stop once per contraction, if it fires the degrees
+// seen so far are returned, which is still a lower bound.
+size_t lower_bound(const Graph &graph, const std::function<bool()> &stop = {}) {
   Graph graph_copy(graph);
   size_t max_degree(0);
   using value_t = decltype(graph_copy.begin())::value_type;
 
   while (graph_copy.order() > 0) {
+    if (stop && stop()) {
+      return max_degree;
+    }
     auto u = std::min_element(
         std::begin(graph_copy),
         std::end(graph_copy),
@@ -98,7 +157,7 @@ size_t lower_bound(const Graph &graph) {
 
     auto neighbors = graph_copy.getNeighborhood(u->first);
 
-    auto cmp = [graph_copy, neighbors](vertex_index_t u, vertex_index_t v) {
+    auto cmp = [&graph_copy](vertex_index_t u, vertex_index_t v) {
       auto u_nb = graph_copy.getNeighborhood(u);
 
       auto v_nb = graph_copy.getNeighborhood(v);
@@ -118,42 +177,94 @@ size_t lower_bound(const Graph &graph) {
   return max_degree;
 }
 
-std::pair<size_t, adj_arr_t> quickbb(Graph graph, size_t alloted_time) {
+struct solve_result_t {
+  size_t width{};
+  adj_arr_t order{};
+  // the search ran to completion, so no order of smaller width exists
+  bool optimal{};
+};
+
+// Called with every width below that of the seed order and its order, from
+// whichever solver thread found it. Returning false stops the search.
+typedef std::function<bool(size_t, const adj_arr_t &)> improvement_callback_t;
+
+struct solve_options_t {
+  std::chrono::milliseconds time_limit{std::chrono::seconds(360)};
+  improvement_callback_t on_improvement{};
+  // polled on every branch and heuristic step, the search returns its best order once it is set
+  const std::atomic<bool> *cancelled{nullptr};
+  // seeds the upper bound in place of the min fill heuristic, e.g. a previous result
+  adj_arr_t initial_order{};
+  // a known lower bound on the treewidth, the search stops once it is reached
+  size_t known_lower_bound{0};
+};
+
+solve_result_t solve(Graph graph, const solve_options_t &options) {
   auto start = std::chrono::steady_clock::now();
+  auto deadline = start + options.time_limit;
+
+  std::atomic<bool> stop{false};
+  auto should_stop = [&options, &stop, deadline]() {
+    return stop.load(std::memory_order_relaxed) ||
+        (options.cancelled != nullptr && options.cancelled->load(std::memory_order_relaxed)) ||
+        std::chrono::steady_clock::now() > deadline;
+  };
 
-  auto upper_bound_pair =
-      upper_bound(graph);
-  auto lb =
-      lower_bound(graph);
+  // the seed is cheap, so the heuristics below may be interrupted at any point
+  auto seed = evaluate_order(graph, options.initial_order.empty() ? degree_order(graph) : options.initial_order);
+  SharedBound bound(seed.second, seed.first,
+                    [&options, &stop](size_t width, const adj_arr_t &order) {
+                      if (options.on_improvement && !options.on_improvement(width, order)) {
+                        stop = true;
+                      }
+                    });
+  if (options.initial_order.empty()) {
+    auto min_fill = upper_bound(graph, should_stop);
+    bound.offer(min_fill.second, min_fill.first);
+  }
+  auto lb = std::max(
+      lower_bound(graph, should_stop), options.known_lower_bound);
 
-  auto best_order = upper_bound_pair.first;
-  auto best_upper_bound = upper_bound_pair.second;
+  std::thread local_search_thread;
+  if (lb < bound.width() && !should_stop()) {
+    // bb improves graph in place, so the thread works on its own copy
+    local_search_thread = std::thread([graph_copy = graph, initial_order = bound.get().second, lb, &bound, &stop, deadline]() {
+      local_search(graph_copy, initial_order, lb, bound, stop, deadline);
+    });
+  }
 
   adj_arr_t order;
+  auto interrupted = false;
 
-  std::function<void(Graph &, adj_arr_t, size_t, size_t)> bb;
+  std::function<void(Graph &, adj_arr_t, size_t, size_t, size_t)> bb;
 
   bb = [
-      alloted_time,
-      start,
+      &should_stop,
+      &interrupted,
       &bb,
-      &best_upper_bound,
-      &best_order,
+      &bound,
       lb]
-      (Graph &graph, adj_arr_t order, size_t f, size_t g) mutable {
-    auto time = std::chrono::steady_clock::now() - start;
-    auto time_in_seconds = std::chrono::duration_cast<std::chrono::seconds>(time).count();
-    if (time_in_seconds > alloted_time) {
+      (Graph &graph, adj_arr_t order, size_t f, size_t g, size_t improved_for) mutable {
+    if (should_stop()) {
+      interrupted = true;
+      return;
+    }
+    // only widths below the bound are searched for, so the graph may be improved
+    // for it, unless the bound is already proven
+    auto ub = bound.width();
+    if (ub <= lb) {
       return;
     }
-    if (graph.order() < 2 && f < best_upper_bound) {
+    if (ub < improved_for) {
+      improve_graph(graph, ub);
+      improved_for = ub;
+    }
+    if (graph.order() < 2 && f < bound.width()) {
       assert(f == g);
-      best_upper_bound = f;
-      std::cout << "found new best upperbound: " << best_upper_bound << std::endl;
-      best_order = adj_arr_t(order);
       for (const auto &v : graph) {
-        best_order.emplace_back(v.first);
+        order.emplace_back(v.first);
       }
+      bound.offer(f, order);
     } else {
       adj_arr_t vertices;
       for (const auto &a : graph) {
@@ -167,68 +278,118 @@ std::pair<size_t, adj_arr_t> quickbb(Graph graph, size_t alloted_time) {
         }
       }
       for (auto v : vertices) {
+        if (interrupted) return;
         auto next_graph(graph);
         eliminate(next_graph, v);
         auto next_order(order);
         next_order.emplace_back(v);
         auto next_g = std::max(g, graph.getNeighborhood(v).size());
-        auto next_f = std::max(g, lower_bound(next_graph));
-        if (next_f < best_upper_bound) {
-          bb(next_graph, next_order, next_f, next_g);
+        auto next_f = std::max(g, lower_bound(next_graph, should_stop));
+        if (next_f < bound.width()) {
+          bb(next_graph, next_order, next_f, next_g, improved_for);
         }
       }
     }
   };
 
-  if (lb < best_upper_bound) {
-    bb(graph, order, lb, 0);
+  if (lb < bound.width()) {
+    bb(graph, order, lb, 0, std::numeric_limits<size_t>::max());
+  }
+  interrupted = interrupted || stop;
+  stop = true;
+  if (local_search_thread.joinable()) {
+    local_search_thread.join();
   }
+  auto[width, best_order] = bound.get();
+  return {width, best_order, !interrupted || width <= lb};
+}
+
+// Runs solve, reporting progress on stdout.
+solve_result_t quickbb(Graph graph, size_t alloted_time, adj_arr_t initial_order) {
+  auto start = std::chrono::steady_clock::now();
+  solve_options_t options;
+  options.time_limit = std::chrono::seconds(alloted_time);
+  options.on_improvement = [](size_t width, const adj_arr_t &) {
+    std::cout << "found new best upperbound: " << width << std::endl;
+    return true;
+  };
+  options.initial_order = std::move(initial_order);
+  auto result = solve(std::move(graph), options);
   auto time = std::chrono::steady_clock::now() - start;
   auto time_in_seconds = std::chrono::duration_cast<std::chrono::seconds>(time).count();
-  std::cout << "found elimination order with width " << best_upper_bound << " in " << time_in_seconds << " seconds." << std::endl;
-  return {best_upper_bound, best_order};
+  std::cout << "found elimination order with width " << result.width << " in " << time_in_seconds << " seconds." << std::endl;
+  return result;
+}
+
+std::pair<size_t, adj_arr_t> quickbb(Graph graph, size_t alloted_time) {
+  auto result = quickbb(std::move(graph), alloted_time, {});
+  return {result.width, result.order};
 }
 
+// Node i of the tree is the bag created when eliminating order[i]. Its parent
+// is the node of the first eliminated vertex among its higher neighbours. The
+// bags are read off a single OrderEvaluator pass, without eliminating.
 Tree td_from_order(const Graph& graph, const std::vector<vertex_index_t>& order) {
-  Tree tree;
-  auto graph_copy(graph);
-  std::vector<std::pair<vertex_index_t , std::set<vertex_index_t >>> stack;
-
-  for(auto v : order) {
-    auto nb = graph_copy.getNeighborhood(v);
-    stack.emplace_back(
-        std::make_pair(v, std::set<vertex_index_t>{nb.begin(), nb.end()})
-        );
-    eliminate(graph_copy, v);
+  const auto compact = make_compact(graph);
+  const auto full = complete_order(compact, order);
+  OrderEvaluator evaluator(compact);
+  evaluator.evaluate(full, full.size());
+
+  // vertices left out of order are eliminated after it and get no node
+  std::unordered_set<vertex_index_t> in_order(order.begin(), order.end());
+  size_t nodes = 0;
+  while (nodes < full.size() && in_order.contains(compact.labels[full[nodes]])) {
+    nodes++;
   }
 
-  for(auto it = stack.rbegin(); it != stack.rend(); it++) {
-    auto tmp = *it;
-    if(tree.order() == 0) {
-      auto &v = tree.addNode(tmp.first);
-      v._bag = std::set<vertex_index_t >{tmp.second};
-      v._bag.insert(tmp.first);
-      tree.setRoot(tmp.first);
-    } else {
-      for(const auto& w : tree) {
-        auto sub_set = true;
-        for(auto v : tmp.second) {
-          if(!w.second._bag.contains(v)) {
-            sub_set = false;
-            break;
-          }
-        }
-        if(sub_set) {
-          auto &v = tree.addNode(tmp.first);
-          v._bag = std::set<vertex_index_t >{tmp.second};
-          v._bag.insert(tmp.first);
-          tree.connectToParent(w.first, tmp.first);
-          break;
-        }
+  adj_arr_t labels;
+  labels.reserve(nodes);
+  std::vector<size_t> bag_offsets{0};
+  bag_offsets.reserve(nodes + 1);
+  std::vector<vertex_index_t> bags;
+  std::vector<tree_index_t> parents(nodes, Tree::NO_PARENT);
+  for(tree_index_t i = 0; i < nodes; i++) {
+    auto v = full[i];
+    labels.emplace_back(compact.labels[v]);
+    bags.emplace_back(compact.labels[v]);
+    for(auto u : evaluator.higher(v)) {
+      bags.emplace_back(compact.labels[u]);
+    }
+    bag_offsets.emplace_back(bags.size());
+    if(evaluator.parent(i) < nodes) {
+      parents[i] = evaluator.parent(i);
+    }
+  }
+
+  // vertices left out of the order end their component, a forest is joined at the last root
+  tree_index_t root = Tree::NO_PARENT;
+  for(tree_index_t i = nodes; i-- > 0;) {
+    if(parents[i] == Tree::NO_PARENT) {
+      if(root == Tree::NO_PARENT) {
+        root = i;
+      } else {
+        parents[i] = root;
       }
     }
   }
-  return tree;
+  return {std::move(labels), std::move(parents), std::move(bag_offsets), std::move(bags)};
+}
+
+// Eliminates the vertices of each bag that are not in its parent's bag,
+// bottom up. The width of the order is at most that of the tree.
+adj_arr_t order_from_td(const Tree &tree) {
+  adj_arr_t order;
+  for (auto i : tree.postorder()) {
+    auto bag = tree.bag(i);
+    if (tree.parent(i) == Tree::NO_PARENT) {
+      order.insert(order.end(), bag.begin(), bag.end());
+      continue;
+    }
+    auto parent_bag = tree.bag(tree.parent(i));
+    std::set_difference(bag.begin(), bag.end(), parent_bag.begin(), parent_bag.end(),
+                        std::back_inserter(order));
+  }
+  return order;
 }
 
 #endif //QUICKBB_QUICKBB_HPP
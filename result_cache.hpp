@@ -0,0 +1,604 @@
+#ifndef QUICKBB_RESULT_CACHE_HPP
+#define QUICKBB_RESULT_CACHE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "graph.hpp"
+#include "local_search.hpp"
+#include "quickbb.hpp"
+#include "_types.hpp"
+
+uint64_t mix_hash(uint64_t seed, uint64_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+  seed ^= seed >> 31;
+  seed *= 0xbf58476d1ce4e5b9ULL;
+  seed ^= seed >> 27;
+  return seed;
+}
+
+// Canonical relabeling by individualisation-refinement: equitable refinement
+// of an ordered partition, then individualising each vertex of the smallest
+// non-singleton cell in turn, until the partition is discrete. Of all discrete
+// partitions reached, the one with the smallest (trace, edge list) is kept, so
+// isomorphic graphs get the same key and canonical index i is the same vertex
+// up to automorphism. If the search exceeds its work limit, the key is only a
+// hash of the refined partition and the labels are not canonical.
+struct canonical_form_t {
+  uint64_t key{};
+  size_t edges{};
+  // the labels are canonical, otherwise isomorphic graphs share the key but
+  // their labels may differ
+  bool exact{};
+  // canonical index -> vertex
+  adj_arr_t labels{};
+  std::unordered_map<vertex_index_t, uint32_t> index{};
+};
+
+class CanonicalLabeling {
+ private:
+  typedef std::vector<std::pair<uint32_t, uint32_t>> certificate_t;
+
+  // Cells are contiguous ranges of elements, a cell is named by its start.
+  struct partition_t {
+    adj_arr_t elements{};
+    // vertex -> index in elements
+    adj_arr_t position{};
+    // vertex -> start of its cell
+    adj_arr_t cell{};
+    // cell start -> end of the cell
+    adj_arr_t cell_end{};
+    size_t cells{};
+  };
+
+  const compact_graph_t &m_graph_;
+  // bounds vertex and edge visits of the whole search
+  size_t m_work_limit_;
+  size_t m_work_{0};
+  bool m_found_{false};
+  std::vector<uint64_t> m_best_trace_{};
+  certificate_t m_best_certificate_{};
+  adj_arr_t m_best_position_{};
+  adj_arr_t m_best_path_{};
+  // automorphisms found from leaves equal to the best, used to skip branches
+  // that are images of explored ones
+  std::vector<adj_arr_t> m_automorphisms_{};
+  adj_arr_t m_path_{};
+  // scratch space of refine, all zero between calls
+  std::vector<size_t> m_count_{};
+  std::vector<bool> m_queued_{};
+
+  bool exhausted() const {
+    return m_work_ > m_work_limit_;
+  }
+
+  // orbits of the automorphisms that fix every individualised vertex
+  adj_arr_t orbits() {
+    const auto n = m_graph_.labels.size();
+    adj_arr_t parent(n);
+    for (size_t v = 0; v < n; v++) {
+      parent[v] = v;
+    }
+    auto find = [&parent](vertex_index_t v) {
+      while (parent[v] != v) v = parent[v] = parent[parent[v]];
+      return v;
+    };
+    for (const auto &gamma : m_automorphisms_) {
+      m_work_ += n;
+      auto fixes_path = std::all_of(m_path_.begin(), m_path_.end(), [&gamma](auto w) {
+        return gamma[w] == w;
+      });
+      if (!fixes_path) continue;
+      for (size_t v = 0; v < n; v++) {
+        parent[find(v)] = find(gamma[v]);
+      }
+    }
+    for (size_t v = 0; v < n; v++) {
+      parent[v] = find(v);
+    }
+    return parent;
+  }
+
+  // Splits cells by the number of neighbours in each splitter, until the
+  // partition is equitable. Only the counted vertices of a cell move: they go
+  // behind the uncounted ones, in increasing count order. Every decision
+  // depends on cell starts and counts only, so the result is independent of
+  // the labels. Returns a hash of the splits, the trace of this node.
+  uint64_t refine(partition_t &p, std::vector<size_t> splitters) {
+    const auto n = p.elements.size();
+    for (auto w : splitters) {
+      m_queued_[w] = true;
+    }
+    auto invariant = mix_hash(0, n);
+    std::vector<vertex_index_t> touched;
+    for (size_t head = 0; head < splitters.size(); head++) {
+      const auto w = splitters[head];
+      m_queued_[w] = false;
+      if (p.cells == n) continue;
+
+      touched.clear();
+      for (auto i = w; i < p.cell_end[w]; i++) {
+        for (auto u : m_graph_.adj[p.elements[i]]) {
+          if (m_count_[u]++ == 0) touched.emplace_back(u);
+        }
+        m_work_ += m_graph_.adj[p.elements[i]].size() + 1;
+      }
+      std::sort(touched.begin(), touched.end(), [&p, this](auto a, auto b) {
+        return std::make_pair(p.cell[a], m_count_[a]) < std::make_pair(p.cell[b], m_count_[b]);
+      });
+      m_work_ += touched.size();
+
+      for (size_t first = 0; first < touched.size();) {
+        const auto c = p.cell[touched[first]];
+        auto last = first;
+        while (last < touched.size() && p.cell[touched[last]] == c) last++;
+        const auto end = p.cell_end[c];
+        const auto untouched = end - c - (last - first);
+        if (untouched == 0 && m_count_[touched[first]] == m_count_[touched[last - 1]]) {
+          first = last;
+          continue;
+        }
+
+        // counted vertices to the back of the cell
+        for (auto k = first; k < last; k++) {
+          const auto target = end - (last - first) + (k - first);
+          const auto u = touched[k];
+          const auto displaced = p.elements[target];
+          std::swap(p.elements[p.position[u]], p.elements[target]);
+          p.position[displaced] = p.position[u];
+          p.position[u] = target;
+        }
+
+        // fragments in order: uncounted, then by increasing count
+        std::vector<std::pair<size_t, size_t>> fragments;
+        if (untouched > 0) fragments.emplace_back(c, c + untouched);
+        for (auto k = first; k < last;) {
+          auto group_end = k;
+          while (group_end < last && m_count_[touched[group_end]] == m_count_[touched[k]]) group_end++;
+          const auto from = end - (last - first) + (k - first);
+          fragments.emplace_back(from, from + (group_end - k));
+          invariant = mix_hash(invariant, (uint64_t(from) << 32) ^ m_count_[touched[k]]);
+          k = group_end;
+        }
+        for (const auto &[from, to] : fragments) {
+          p.cell_end[from] = to;
+          if (from == c) continue;
+          for (auto i = from; i < to; i++) {
+            p.cell[p.elements[i]] = from;
+          }
+        }
+        p.cells += fragments.size() - 1;
+
+        // a cell that is not queued already splits its neighbours as the
+        // other fragments do, so the first largest one is left out
+        auto largest = fragments.begin();
+        if (!m_queued_[c]) {
+          for (auto f = fragments.begin(); f != fragments.end(); f++) {
+            if (f->second - f->first > largest->second - largest->first) largest = f;
+          }
+        }
+        for (auto f = fragments.begin(); f != fragments.end(); f++) {
+          if ((m_queued_[c] || f != largest) && !m_queued_[f->first]) {
+            m_queued_[f->first] = true;
+            splitters.emplace_back(f->first);
+          }
+        }
+        first = last;
+      }
+      for (auto u : touched) {
+        m_count_[u] = 0;
+      }
+    }
+    return mix_hash(invariant, p.cells);
+  }
+
+  // Edges as (larger, smaller) position pairs, ordered by both.
+  certificate_t certificate(const partition_t &p) {
+    const auto n = p.elements.size();
+    certificate_t edges;
+    for (size_t j = 0; j < n; j++) {
+      const auto first = edges.size();
+      for (auto u : m_graph_.adj[p.elements[j]]) {
+        if (p.position[u] < j) edges.emplace_back(j, p.position[u]);
+      }
+      std::sort(edges.begin() + first, edges.end());
+      m_work_ += m_graph_.adj[p.elements[j]].size() + 1;
+    }
+    return edges;
+  }
+
+  // equal is set while trace agrees with the best trace so far. Returns the
+  // depth the search continues at, which is above this node if the rest of
+  // its subtree is an image of an explored one.
+  size_t search(partition_t &p, uint64_t invariant, std::vector<uint64_t> &trace, bool equal) {
+    const auto n = p.elements.size();
+    const auto depth = trace.size();
+    trace.emplace_back(invariant);
+    if (m_found_ && equal && depth < m_best_trace_.size()) {
+      if (invariant > m_best_trace_[depth]) {
+        trace.pop_back();
+        return depth;
+      }
+      equal = invariant == m_best_trace_[depth];
+    }
+
+    if (p.cells == n) {
+      auto leaf = certificate(p);
+      if (m_found_ && trace == m_best_trace_ && leaf == m_best_certificate_) {
+        adj_arr_t gamma(n);
+        for (size_t v = 0; v < n; v++) {
+          gamma[v] = p.elements[m_best_position_[v]];
+        }
+        m_automorphisms_.emplace_back(std::move(gamma));
+        m_work_ += n;
+        // the branch off the best path maps onto the explored best one
+        trace.pop_back();
+        return std::mismatch(m_path_.begin(), m_path_.end(), m_best_path_.begin()).first - m_path_.begin();
+      } else if (!m_found_ || std::tie(trace, leaf) < std::tie(m_best_trace_, m_best_certificate_)) {
+        m_found_ = true;
+        m_best_trace_ = trace;
+        m_best_certificate_ = std::move(leaf);
+        m_best_position_ = p.position;
+        m_best_path_ = m_path_;
+      }
+      trace.pop_back();
+      return depth;
+    }
+
+    size_t target = n;
+    for (size_t c = 0; c < n; c = p.cell_end[c]) {
+      const auto size = p.cell_end[c] - c;
+      if (size > 1 && (target == n || size < p.cell_end[target] - target)) target = c;
+    }
+    const adj_arr_t candidates(p.elements.begin() + target, p.elements.begin() + p.cell_end[target]);
+    std::vector<vertex_index_t> explored;
+    size_t known_automorphisms = 0;
+    adj_arr_t orbit;
+    for (auto v : candidates) {
+      if (exhausted()) break;
+      // the first branch needs no orbits, which keeps descents cheap
+      if (!explored.empty() && known_automorphisms != m_automorphisms_.size()) {
+        known_automorphisms = m_automorphisms_.size();
+        orbit = orbits();
+      }
+      if (!orbit.empty() && std::any_of(explored.begin(), explored.end(), [&orbit, v](auto u) {
+        return orbit[u] == orbit[v];
+      })) {
+        continue;
+      }
+      explored.emplace_back(v);
+
+      // v becomes a singleton at the end of its cell
+      auto child = p;
+      m_work_ += n;
+      const auto end = child.cell_end[target];
+      const auto displaced = child.elements[end - 1];
+      std::swap(child.elements[child.position[v]], child.elements[end - 1]);
+      child.position[displaced] = child.position[v];
+      child.position[v] = end - 1;
+      child.cell_end[target] = end - 1;
+      child.cell[v] = end - 1;
+      child.cell_end[end - 1] = end;
+      child.cells++;
+      const auto child_invariant = refine(child, {end - 1});
+
+      m_path_.emplace_back(v);
+      const auto resume = search(child, child_invariant, trace, equal);
+      m_path_.pop_back();
+      if (resume < depth) {
+        trace.pop_back();
+        return resume;
+      }
+    }
+    trace.pop_back();
+    return depth;
+  }
+
+ public:
+  explicit CanonicalLabeling(const compact_graph_t &graph) : m_graph_(graph) {
+    size_t size = graph.labels.size();
+    for (const auto &nb : graph.adj) {
+      size += nb.size();
+    }
+    m_work_limit_ = 32 * size + (size_t(1) << 23);
+  }
+
+  // Compact vertex -> canonical index, empty if the work limit was hit. Then
+  // invariant is a hash of the refined partition and root its vertices, cell
+  // by cell.
+  adj_arr_t run(uint64_t &invariant, adj_arr_t &root) {
+    const auto n = m_graph_.labels.size();
+    m_count_.assign(n, 0);
+    m_queued_.assign(n, false);
+
+    partition_t p;
+    p.elements.resize(n);
+    p.position.resize(n);
+    p.cell.assign(n, 0);
+    p.cell_end.assign(n, n);
+    p.cells = n == 0 ? 0 : 1;
+    for (size_t v = 0; v < n; v++) {
+      p.elements[v] = v;
+      p.position[v] = v;
+    }
+    invariant = n == 0 ? 0 : refine(p, {0});
+    root = p.elements;
+
+    std::vector<uint64_t> trace;
+    search(p, invariant, trace, true);
+    if (exhausted()) return {};
+    return m_best_position_;
+  }
+};
+
+canonical_form_t canonical_form(const Graph &graph) {
+  const auto compact = make_compact(graph);
+  const auto n = compact.labels.size();
+  uint64_t invariant;
+  adj_arr_t root;
+  auto canonical = CanonicalLabeling(compact).run(invariant, root);
+
+  canonical_form_t form;
+  form.exact = canonical.size() == n;
+  if (!form.exact) {
+    canonical.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      canonical[root[i]] = i;
+    }
+  }
+  form.labels.resize(n);
+  for (size_t v = 0; v < n; v++) {
+    form.labels[canonical[v]] = compact.labels[v];
+    form.index[compact.labels[v]] = canonical[v];
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  for (size_t v = 0; v < n; v++) {
+    for (auto u : compact.adj[v]) {
+      if (canonical[v] < canonical[u]) edges.emplace_back(canonical[v], canonical[u]);
+    }
+  }
+  form.edges = edges.size();
+  form.key = mix_hash(mix_hash(0, n), edges.size());
+  if (!form.exact) {
+    form.key = mix_hash(form.key, invariant);
+    return form;
+  }
+  std::sort(edges.begin(), edges.end());
+  for (const auto &[u, v] : edges) {
+    form.key = mix_hash(form.key, (uint64_t(u) << 32) | v);
+  }
+  return form;
+}
+
+// File of solve results, one record per graph, looked up through a read only
+// mapping. Layout: a cache_header_t, an open addressing table of
+// cache_slot_t keyed by the canonical key, then the records. A record is a
+// cache_record_t followed by room for an order of all its vertices as
+// uint32_t canonical indices, padded to 8 bytes, so a better result for the
+// same graph is written in place. Readers hold a shared and writers an
+// exclusive flock on the file.
+class ResultCache {
+ private:
+  static constexpr uint64_t MAGIC = 0x3230484341434242ULL; // "BBCACH02"
+  static constexpr uint64_t INITIAL_SLOTS = 64;
+
+  struct cache_header_t {
+    uint64_t magic;
+    uint64_t slot_count;
+    uint64_t used;
+  };
+
+  struct cache_slot_t {
+    uint64_t key;
+    // 0 marks an empty slot
+    uint64_t offset;
+  };
+
+  struct cache_record_t {
+    uint64_t key;
+    uint64_t vertices;
+    uint64_t edges;
+    uint64_t width;
+    uint64_t optimal;
+    uint64_t order_length;
+  };
+
+  std::string m_path_;
+
+  static size_t padded(size_t order_length) {
+    return (order_length * sizeof(uint32_t) + 7) / 8 * 8;
+  }
+
+  static size_t table_end(uint64_t slot_count) {
+    return sizeof(cache_header_t) + slot_count * sizeof(cache_slot_t);
+  }
+
+  // Slot holding key, or the empty slot it would go to.
+  static size_t probe(const std::vector<cache_slot_t> &slots, uint64_t key) {
+    auto i = key % slots.size();
+    while (slots[i].offset != 0 && slots[i].key != key) {
+      i = (i + 1) % slots.size();
+    }
+    return i;
+  }
+
+  static bool write_all(int fd, const void *data, size_t size, size_t offset) {
+    return ::pwrite(fd, data, size, off_t(offset)) == ssize_t(size);
+  }
+
+  static bool read_all(int fd, void *data, size_t size, size_t offset) {
+    return ::pread(fd, data, size, off_t(offset)) == ssize_t(size);
+  }
+
+  // Doubles the table, moving the records behind it.
+  static bool grow(int fd, cache_header_t &header, std::vector<cache_slot_t> &slots, size_t file_size) {
+    const auto old_end = table_end(header.slot_count);
+    const auto new_count = header.slot_count * 2;
+    const auto shift = table_end(new_count) - old_end;
+    std::vector<char> records(file_size - old_end);
+    if (!read_all(fd, records.data(), records.size(), old_end)) return false;
+
+    std::vector<cache_slot_t> grown(new_count, cache_slot_t{0, 0});
+    for (const auto &slot : slots) {
+      if (slot.offset == 0) continue;
+      grown[probe(grown, slot.key)] = {slot.key, slot.offset + shift};
+    }
+    header.slot_count = new_count;
+    std::vector<char> file(table_end(new_count) + records.size());
+    std::memcpy(file.data(), &header, sizeof(header));
+    std::memcpy(file.data() + sizeof(header), grown.data(), grown.size() * sizeof(cache_slot_t));
+    std::memcpy(file.data() + table_end(new_count), records.data(), records.size());
+    if (!write_all(fd, file.data(), file.size(), 0)) return false;
+    slots = std::move(grown);
+    return true;
+  }
+
+  static void store_locked(int fd,
+                           size_t size,
+                           uint64_t key,
+                           const cache_record_t &record,
+                           const std::vector<char> &buffer) {
+    cache_header_t header{MAGIC, INITIAL_SLOTS, 0};
+    std::vector<cache_slot_t> slots;
+    if (size == 0) {
+      std::vector<char> empty(table_end(INITIAL_SLOTS), 0);
+      std::memcpy(empty.data(), &header, sizeof(header));
+      if (!write_all(fd, empty.data(), empty.size(), 0)) return;
+      size = empty.size();
+      slots.assign(INITIAL_SLOTS, cache_slot_t{0, 0});
+    } else {
+      if (size < sizeof(header) || !read_all(fd, &header, sizeof(header), 0)) return;
+      if (header.magic != MAGIC || header.slot_count == 0 || table_end(header.slot_count) > size) return;
+      slots.resize(header.slot_count);
+      if (!read_all(fd, slots.data(), slots.size() * sizeof(cache_slot_t), sizeof(header))) return;
+    }
+
+    auto i = probe(slots, key);
+    if (slots[i].offset != 0) {
+      cache_record_t stored;
+      if (read_all(fd, &stored, sizeof(stored), slots[i].offset) && stored.vertices == record.vertices) {
+        auto better = record.width < stored.width ||
+            (record.width == stored.width && record.optimal && !stored.optimal);
+        if (better) write_all(fd, buffer.data(), buffer.size(), slots[i].offset);
+        return;
+      }
+    } else if ((header.used + 1) * 2 > header.slot_count) {
+      if (!grow(fd, header, slots, size)) return;
+      size += table_end(header.slot_count) - table_end(header.slot_count / 2);
+      i = probe(slots, key);
+    }
+
+    // records are only appended after the table, as one write
+    if (!write_all(fd, buffer.data(), buffer.size(), size)) return;
+    if (slots[i].offset == 0) header.used++;
+    slots[i] = {key, size};
+    write_all(fd, &slots[i], sizeof(cache_slot_t), sizeof(header) + i * sizeof(cache_slot_t));
+    write_all(fd, &header, sizeof(header), 0);
+  }
+
+ public:
+  explicit ResultCache(std::string path) : m_path_(std::move(path)) {}
+
+  // Stored result for graph, with its order translated to graph's labels.
+  // form is canonical_form(graph), so a caller that also stores computes it once.
+  [[nodiscard]]
+  std::optional<solve_result_t> lookup(const Graph &graph, const canonical_form_t &form) const {
+    int fd = ::open(m_path_.c_str(), O_RDONLY);
+    if (fd < 0) return std::nullopt;
+    ::flock(fd, LOCK_SH);
+
+    std::optional<cache_record_t> found;
+    std::vector<uint32_t> indices;
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(cache_header_t)) {
+      const auto size = size_t(st.st_size);
+      void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping != MAP_FAILED) {
+        const auto *data = static_cast<const char *>(mapping);
+        cache_header_t header;
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic == MAGIC && header.slot_count > 0 && table_end(header.slot_count) <= size) {
+          const auto *slots = reinterpret_cast<const cache_slot_t *>(data + sizeof(header));
+          for (auto i = form.key % header.slot_count, step = uint64_t(0);
+               step < header.slot_count && slots[i].offset != 0;
+               i = (i + 1) % header.slot_count, step++) {
+            if (slots[i].key != form.key) continue;
+            const auto offset = slots[i].offset;
+            if (offset < table_end(header.slot_count) || offset > size || size - offset < sizeof(cache_record_t)) break;
+            cache_record_t record;
+            std::memcpy(&record, data + offset, sizeof(record));
+            // a corrupted record must not send the reads out of the file
+            if (record.key != form.key || record.vertices != form.labels.size() ||
+                record.edges != form.edges || record.order_length > record.vertices ||
+                padded(record.vertices) > size - offset - sizeof(record)) {
+              break;
+            }
+            const auto *order = reinterpret_cast<const uint32_t *>(data + offset + sizeof(record));
+            indices.assign(order, order + record.order_length);
+            found = record;
+            break;
+          }
+        }
+        ::munmap(mapping, size);
+      }
+    }
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    if (!found) return std::nullopt;
+
+    adj_arr_t order;
+    for (auto i : indices) {
+      if (i < form.labels.size()) order.emplace_back(form.labels[i]);
+    }
+    // an isomorphism keeps the width, any other width is a key collision; a
+    // key that is only an invariant still gives an order to start from
+    auto evaluated = evaluate_order(graph, order);
+    if (form.exact && evaluated.second != found->width) return std::nullopt;
+    return solve_result_t{evaluated.second, evaluated.first, form.exact && found->optimal != 0};
+  }
+
+  [[nodiscard]]
+  std::optional<solve_result_t> lookup(const Graph &graph) const {
+    return lookup(graph, canonical_form(graph));
+  }
+
+  // Stores result unless the cache holds one at least as good for graph.
+  void store(const Graph &graph, const canonical_form_t &form, const solve_result_t &result) const {
+    cache_record_t record{form.key, form.labels.size(), form.edges, result.width, result.optimal, 0};
+    std::vector<uint32_t> indices;
+    for (auto v : result.order) {
+      auto found = form.index.find(v);
+      if (found != form.index.end()) indices.emplace_back(found->second);
+    }
+    record.order_length = indices.size();
+    std::vector<char> buffer(sizeof(record) + padded(record.vertices), 0);
+    std::memcpy(buffer.data(), &record, sizeof(record));
+    std::memcpy(buffer.data() + sizeof(record), indices.data(), indices.size() * sizeof(uint32_t));
+
+    int fd = ::open(m_path_.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+    ::flock(fd, LOCK_EX);
+    struct stat st{};
+    if (::fstat(fd, &st) == 0) {
+      store_locked(fd, size_t(st.st_size), form.key, record, buffer);
+    }
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+  }
+
+  void store(const Graph &graph, const solve_result_t &result) const {
+    store(graph, canonical_form(graph), result);
+  }
+};
+
+#endif //QUICKBB_RESULT_CACHE_HPP
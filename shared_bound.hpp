@@ -0,0 +1,46 @@
+#ifndef QUICKBB_SHARED_BOUND_HPP
+#define QUICKBB_SHARED_BOUND_HPP
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include "_types.hpp"
+
+// Best known elimination order and its width, shared between the
+// branch and bound and the local search improver running next to it.
+class SharedBound {
+ private:
+  std::atomic<size_t> m_width_;
+  adj_arr_t m_order_;
+  std::function<void(size_t, const adj_arr_t &)> m_on_improvement_;
+  mutable std::mutex m_mutex_;
+ public:
+  // on_improvement runs under the lock, so calls never overlap.
+  SharedBound(size_t width, adj_arr_t order, std::function<void(size_t, const adj_arr_t &)> on_improvement = {})
+      : m_width_(width), m_order_(std::move(order)), m_on_improvement_(std::move(on_improvement)) {}
+
+  // Lock free, cheap enough to be read on every branch.
+  [[nodiscard]]
+  size_t width() const {
+    return m_width_.load(std::memory_order_relaxed);
+  }
+
+  // Publishes order if it is strictly better than the current best.
+  bool offer(size_t width, const adj_arr_t &order) {
+    std::lock_guard<std::mutex> lock(m_mutex_);
+    if (width >= m_width_.load(std::memory_order_relaxed)) return false;
+    m_order_ = order;
+    m_width_.store(width, std::memory_order_relaxed);
+    if (m_on_improvement_) m_on_improvement_(width, m_order_);
+    return true;
+  }
+
+  [[nodiscard]]
+  std::pair<size_t, adj_arr_t> get() const {
+    std::lock_guard<std::mutex> lock(m_mutex_);
+    return {m_width_.load(std::memory_order_relaxed), m_order_};
+  }
+};
+
+#endif //QUICKBB_SHARED_BOUND_HPP
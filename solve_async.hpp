@@ -0,0 +1,48 @@
+#ifndef QUICKBB_SOLVE_ASYNC_HPP
+#define QUICKBB_SOLVE_ASYNC_HPP
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include "graph.hpp"
+#include "quickbb.hpp"
+
+// Handle to a solve running on its own thread. Like any std::async future,
+// the last copy of the result blocks until the solve ends, so cancel first
+// if the result is no longer wanted.
+class SolveHandle {
+ private:
+  std::shared_ptr<std::atomic<bool>> m_cancelled_;
+  std::shared_future<solve_result_t> m_result_;
+ public:
+  SolveHandle(std::shared_ptr<std::atomic<bool>> cancelled, std::shared_future<solve_result_t> result)
+      : m_cancelled_(std::move(cancelled)), m_result_(std::move(result)) {}
+
+  // Asks the search to stop, its result then holds the best order found so far.
+  void cancel() {
+    m_cancelled_->store(true, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]]
+  bool cancelled() const {
+    return m_cancelled_->load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]]
+  std::shared_future<solve_result_t> result() const {
+    return m_result_;
+  }
+};
+
+// Runs solve on a new thread. options.cancelled is replaced by the handle's flag.
+SolveHandle solve_async(Graph graph, solve_options_t options) {
+  auto cancelled = std::make_shared<std::atomic<bool>>(false);
+  options.cancelled = cancelled.get();
+  auto result = std::async(std::launch::async,
+                           [graph = std::move(graph), options = std::move(options), cancelled]() {
+                             return solve(graph, options);
+                           });
+  return {std::move(cancelled), result.share()};
+}
+
+#endif //QUICKBB_SOLVE_ASYNC_HPP
@@ -2,111 +2,156 @@
 #define QUICKBB_TREE_HPP
 #include "_types.hpp"
 #include <vector>
-#include <memory>
-#include <set>
-#include <functional>
+#include <algorithm>
+#include <limits>
+#include <utility>
 #include <iostream>
 
+// Flat tree: node i owns the bag _bags[_bag_offsets[i] .. _bag_offsets[i + 1])
+// and the children _children[_child_offsets[i] .. _child_offsets[i + 1]).
 class Tree {
  private:
-  tree_data_t _m_data{};
-  vertex_index_t _root{};
+  adj_arr_t _labels{};
+  std::vector<tree_index_t> _parents{};
+  std::vector<size_t> _child_offsets{0};
+  std::vector<tree_index_t> _children{};
+  std::vector<size_t> _bag_offsets{0};
+  std::vector<vertex_index_t> _bags{};
+  tree_index_t _root{};
  public:
-  Tree() = default;
-
-  auto begin() {
-    return _m_data.begin();
-  }
-
-  auto end() {
-    return _m_data.end();
-  }
+  static constexpr tree_index_t NO_PARENT = std::numeric_limits<tree_index_t>::max();
 
-  auto begin() const {
-    return _m_data.cbegin();
-  }
-
-  auto end() const {
-    return _m_data.cend();
-  }
+  Tree() = default;
 
-  tree_node_t &addNode(vertex_index_t v) {
-    if (_m_data.find(v) == _m_data.end()) {
-      _m_data[v] = tree_node_t();
+  // parents[i] is NO_PARENT for exactly one node, the root. Bags get sorted.
+  Tree(adj_arr_t labels,
+       std::vector<tree_index_t> parents,
+       std::vector<size_t> bag_offsets,
+       std::vector<vertex_index_t> bags)
+      : _labels(std::move(labels)),
+        _parents(std::move(parents)),
+        _bag_offsets(std::move(bag_offsets)),
+        _bags(std::move(bags)) {
+    const auto n = _labels.size();
+    for (tree_index_t i = 0; i < n; i++) {
+      std::sort(_bags.begin() + _bag_offsets[i], _bags.begin() + _bag_offsets[i + 1]);
     }
-    return _m_data[v];
-  }
 
-  void removeDead() {
-    for (auto it = _m_data.begin(); it != _m_data.end(); it++) {
-      if (it->second._parent == 0 &&
-          it->second._children.empty() &&
-          it->second._bag.empty()) {
-        _m_data.erase(it);
+    _child_offsets.assign(n + 1, 0);
+    for (tree_index_t i = 0; i < n; i++) {
+      if (_parents[i] == NO_PARENT) {
+        _root = i;
+      } else {
+        _child_offsets[_parents[i] + 1]++;
       }
     }
+    for (tree_index_t i = 0; i < n; i++) {
+      _child_offsets[i + 1] += _child_offsets[i];
+    }
+    _children.resize(_child_offsets[n]);
+    std::vector<size_t> fill(_child_offsets.begin(), _child_offsets.end() - 1);
+    for (tree_index_t i = 0; i < n; i++) {
+      if (_parents[i] != NO_PARENT) _children[fill[_parents[i]]++] = i;
+    }
   }
 
-  tree_node_t &getNode(vertex_index_t v) {
-    return _m_data.at(v);
+  [[nodiscard]]
+  vertex_index_t label(tree_index_t i) const {
+    return _labels[i];
   }
 
   [[nodiscard]]
-  const tree_node_t &getNode(vertex_index_t v) const {
-    return _m_data.at(v);
+  bag_t bag(tree_index_t i) const {
+    return {_bags.data() + _bag_offsets[i], _bags.data() + _bag_offsets[i + 1]};
   }
 
-  void setRoot(vertex_index_t v) {
-    if (_m_data.find(v) != _m_data.end()) {
-      _root = v;
-    }
+  [[nodiscard]]
+  node_children_t children(tree_index_t i) const {
+    return {_children.data() + _child_offsets[i], _children.data() + _child_offsets[i + 1]};
   }
 
   [[nodiscard]]
-  vertex_index_t getRoot() const {
-    return _root;
+  tree_index_t parent(tree_index_t i) const {
+    return _parents[i];
   }
 
-  void connectToParent(vertex_index_t parent, vertex_index_t child) {
-    addNode(parent);
-    addNode(child);
+  [[nodiscard]]
+  tree_node_t getNode(tree_index_t i) const {
+    tree_node_t node;
+    node._label = label(i);
+    node._bag = bag(i);
+    node._children = children(i);
+    node._parent = parent(i);
+    return node;
+  }
 
-    _m_data[child]._parent = parent;
-    _m_data[parent]._children.insert(child);
+  [[nodiscard]]
+  tree_index_t getRoot() const {
+    return _root;
   }
 
   [[nodiscard]]
   size_t order() const {
-    return _m_data.size();
+    return _labels.size();
   }
 
-  void contractChildToParent(vertex_index_t parent, vertex_index_t child) {
-    _m_data[parent]._children.erase(child);
-    for (const auto &a : _m_data[child]._children) {
-      _m_data[a]._parent = parent;
-      _m_data[parent]._children.insert(a);
-    }
-    for (const auto &a : _m_data[child]._bag) {
-      _m_data[parent]._bag.insert(a);
+  // Iterative depth first search over node indices, callbacks get
+  // (node, depth, is_leaf, is_last_child).
+  template<typename PostOrder, typename PreOrder>
+  void traverse(PostOrder &&post_order, PreOrder &&pre_order) const {
+    if (order() == 0) return;
+    struct frame_t {
+      tree_index_t node;
+      size_t next_child;
+      bool last_child;
+    };
+    std::vector<frame_t> stack;
+    stack.push_back({_root, 0, true});
+    pre_order(_root, 0, children(_root).empty(), true);
+    while (!stack.empty()) {
+      auto &top = stack.back();
+      auto c = children(top.node);
+      if (top.next_child < c.size()) {
+        auto child = c[top.next_child++];
+        auto last_child = top.next_child == c.size();
+        pre_order(child, stack.size(), children(child).empty(), last_child);
+        stack.push_back({child, 0, last_child});
+      } else {
+        auto node = top.node;
+        auto last_child = top.last_child;
+        stack.pop_back();
+        post_order(node, stack.size(), c.empty(), last_child);
+      }
     }
-    _m_data.erase(child);
   }
 
-  void dfs(std::function<void(const tree_node_t &, size_t, bool, bool)> post_order,
-           std::function<void(const tree_node_t &, size_t, bool, bool)> pre_order)
-  const {
-    std::function<void(vertex_index_t, size_t, bool)> recursion;
-    recursion = [this, &recursion, &post_order, &pre_order]
-        (vertex_index_t v, size_t depth, bool last_child) {
-      auto n = this->_m_data.at(v);
-      pre_order(n, depth, n._children.empty(), last_child);
-      auto i = 0;
-      for (auto c : n._children) {
-        recursion(c, depth + 1, i++ == n._children.size() - 1);
-      }
-      post_order(n, depth, n._children.empty(), last_child);
-    };
-    recursion(this->_root, 0, true);
+  template<typename PostOrder, typename PreOrder>
+  void dfs(PostOrder &&post_order, PreOrder &&pre_order) const {
+    traverse(
+        [this, &post_order](tree_index_t i, size_t depth, bool is_leaf, bool is_last_child) {
+          post_order(getNode(i), depth, is_leaf, is_last_child);
+        },
+        [this, &pre_order](tree_index_t i, size_t depth, bool is_leaf, bool is_last_child) {
+          pre_order(getNode(i), depth, is_leaf, is_last_child);
+        });
+  }
+
+  [[nodiscard]]
+  std::vector<tree_index_t> preorder() const {
+    std::vector<tree_index_t> result;
+    result.reserve(order());
+    traverse([](tree_index_t, size_t, bool, bool) {},
+             [&result](tree_index_t i, size_t, bool, bool) { result.emplace_back(i); });
+    return result;
+  }
+
+  [[nodiscard]]
+  std::vector<tree_index_t> postorder() const {
+    std::vector<tree_index_t> result;
+    result.reserve(order());
+    traverse([&result](tree_index_t i, size_t, bool, bool) { result.emplace_back(i); },
+             [](tree_index_t, size_t, bool, bool) {});
+    return result;
   }
 
   friend std::ostream &operator<<(std::ostream &os, const Tree &tree);